@@ -0,0 +1,47 @@
+#include "common.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static std::string decompress(const std::string& content)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+    {
+        abort();
+    }
+    zs.next_in = (Bytef*)content.data();
+    zs.avail_in = content.size();
+    int ret;
+    char outbuffer[32768];
+    std::string out;
+    do
+    {
+        zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
+        zs.avail_out = sizeof(outbuffer);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        out.append(outbuffer, sizeof(outbuffer) - zs.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+        std::cerr << "inflate failed: " << ret << std::endl;
+        abort();
+    }
+    return out;
+}
+
+// Round trip: whatever compress() produces must be a valid gzip stream that
+// inflates back to the original bytes.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    const std::string content(reinterpret_cast<const char*>(data), size);
+    if (decompress(compress(content)) != content)
+    {
+        std::cerr << "gzip round trip mismatch" << std::endl;
+        abort();
+    }
+    return 0;
+}
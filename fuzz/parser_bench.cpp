@@ -0,0 +1,150 @@
+#include "http_request.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Measures HttpRequest parse throughput over a corpus directory.
+//
+//   parser_bench <corpus_dir> [--baseline <file>] [--max-regression <percent>] [--record]
+//
+// With --baseline the result is compared to the MB/s stored in the file and the
+// program fails if it dropped by more than --max-regression percent, or if the
+// baseline file is missing. --record stores the current result as the baseline.
+
+static std::vector<std::string> load_corpus(const std::filesystem::path& dir)
+{
+    std::vector<std::string> corpus;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(dir))
+    {
+        if (!entry.is_regular_file())
+        {
+            continue;
+        }
+        std::ifstream file(entry.path(), std::ios::in | std::ios::binary);
+        corpus.emplace_back((std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+    }
+    return corpus;
+}
+
+// Keeps the optimizer from discarding the parse results.
+static volatile size_t g_sink = 0;
+
+static double measure(const std::vector<std::string>& corpus)
+{
+    using t_clock = std::chrono::steady_clock;
+    size_t bytes = 0;
+    size_t sink = 0;
+    const auto start = t_clock::now();
+    auto now = start;
+    do
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            for (const auto& raw : corpus)
+            {
+                try
+                {
+                    const HttpRequest request(raw);
+                    sink += request.GetHeaders().size();
+                }
+                catch (const std::exception&)
+                {
+                    ++sink;
+                }
+                bytes += raw.size();
+            }
+        }
+        now = t_clock::now();
+    } while (now - start < std::chrono::milliseconds(300));
+    const double seconds = std::chrono::duration<double>(now - start).count();
+    g_sink = sink;
+    return bytes / seconds / (1024 * 1024);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <corpus_dir> [--baseline <file>] [--max-regression <percent>] [--record]"
+                  << std::endl;
+        return 2;
+    }
+    std::string baseline_path;
+    double max_regression = 10.0;
+    bool record = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if (arg == "--max-regression" && i + 1 < argc)
+        {
+            max_regression = std::stod(argv[++i]);
+        }
+        else if (arg == "--record")
+        {
+            record = true;
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    const auto corpus = load_corpus(argv[1]);
+    if (corpus.empty())
+    {
+        std::cerr << "Empty corpus: " << argv[1] << std::endl;
+        return 2;
+    }
+    // Best of several runs to keep noise from failing the gate.
+    double best = 0;
+    for (int run = 0; run < 5; ++run)
+    {
+        best = std::max(best, measure(corpus));
+    }
+    std::cout << "Parse throughput: " << best << " MB/s" << std::endl;
+    if (baseline_path.empty())
+    {
+        return 0;
+    }
+
+    if (record)
+    {
+        std::ofstream out(baseline_path);
+        if (!(out << best << std::endl))
+        {
+            std::cerr << "Failed to write baseline " << baseline_path << std::endl;
+            return 2;
+        }
+        std::cout << "Recorded baseline in " << baseline_path << std::endl;
+        return 0;
+    }
+    double baseline = 0;
+    std::ifstream in(baseline_path);
+    if (!(in >> baseline) || baseline <= 0)
+    {
+        std::cerr << "No valid baseline in " << baseline_path
+                  << "; record one with --record (the perf-baseline target)" << std::endl;
+        return 1;
+    }
+    const double change = (best - baseline) / baseline * 100.0;
+    std::cout << "Baseline: " << baseline << " MB/s (" << (change >= 0 ? "+" : "") << change
+              << "%)" << std::endl;
+    if (change < -max_regression)
+    {
+        std::cerr << "Parse throughput regressed by more than " << max_regression << "%"
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
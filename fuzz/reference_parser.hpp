@@ -0,0 +1,159 @@
+#ifndef REFERENCE_PARSER_HPP
+#define REFERENCE_PARSER_HPP
+
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Deliberately simple, strict HTTP/1.x request parser used as the oracle for the
+// differential fuzzer. It only accepts well-formed requests (CRLF line endings,
+// single-space separated request line, no duplicate headers); for those the
+// server's HttpRequest must produce exactly the same result.
+struct ReferenceRequest
+{
+    std::string method;
+    std::vector<std::string> target;
+    std::string version;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+inline bool is_visible(char c)
+{
+    return c > 0x20 && c < 0x7f;
+}
+
+inline bool is_token(std::string_view s)
+{
+    if (s.empty())
+    {
+        return false;
+    }
+    for (char c : s)
+    {
+        if (!is_visible(c) || c == ':')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// "/a//b/" -> {"/", "a", "/", "b", "/"}; "/" -> {"/"}
+inline std::vector<std::string> reference_split_target(std::string_view target)
+{
+    std::vector<std::string> tokens;
+    if (target == "/")
+    {
+        tokens.push_back("/");
+        return tokens;
+    }
+    size_t start = 0;
+    while (start <= target.size())
+    {
+        size_t end = target.find('/', start);
+        if (end == std::string_view::npos)
+        {
+            end = target.size();
+        }
+        if (end > start)
+        {
+            tokens.push_back("/");
+            tokens.emplace_back(target.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    if (!target.empty() && target.back() == '/')
+    {
+        tokens.push_back("/");
+    }
+    return tokens;
+}
+
+inline std::optional<ReferenceRequest> reference_parse(std::string_view raw)
+{
+    const size_t head_end = raw.find("\r\n\r\n");
+    if (head_end == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    const std::string_view head = raw.substr(0, head_end + 2);
+    for (size_t i = 0; i < head.size(); ++i)
+    {
+        const bool crlf = head[i] == '\r' && i + 1 < head.size() && head[i + 1] == '\n';
+        if ((head[i] == '\r' && !crlf) || (head[i] == '\n' && (i == 0 || head[i - 1] != '\r')))
+        {
+            return std::nullopt;
+        }
+    }
+
+    ReferenceRequest request;
+    size_t line_end = head.find("\r\n");
+    const std::string_view line = head.substr(0, line_end);
+    const size_t sp1 = line.find(' ');
+    const size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    const std::string_view method = line.substr(0, sp1);
+    const std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    const std::string_view version = line.substr(sp2 + 1);
+    if (method.empty())
+    {
+        return std::nullopt;
+    }
+    for (char c : method)
+    {
+        if (c < 'A' || c > 'Z')
+        {
+            return std::nullopt;
+        }
+    }
+    if (target.empty() || target[0] != '/' || version.find(' ') != std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    for (char c : target)
+    {
+        if (!is_visible(c))
+        {
+            return std::nullopt;
+        }
+    }
+    if (version != "HTTP/1.0" && version != "HTTP/1.1")
+    {
+        return std::nullopt;
+    }
+    request.method = method;
+    request.target = reference_split_target(target);
+    request.version = version;
+
+    size_t start = line_end + 2;
+    while (start < head.size())
+    {
+        line_end = head.find("\r\n", start);
+        const std::string_view header = head.substr(start, line_end - start);
+        const size_t colon = header.find(':');
+        if (colon == std::string_view::npos || !is_token(header.substr(0, colon)))
+        {
+            return std::nullopt;
+        }
+        std::string_view value = header.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        {
+            value.remove_prefix(1);
+        }
+        if (!request.headers.emplace(header.substr(0, colon), value).second)
+        {
+            return std::nullopt;
+        }
+        start = line_end + 2;
+    }
+    request.body = raw.substr(head_end + 4);
+    return request;
+}
+
+#endif // !REFERENCE_PARSER_HPP
@@ -0,0 +1,45 @@
+#include "http_request.hpp"
+#include "reference_parser.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+// Differential target: any input may be rejected with a std::exception, but a
+// request the reference parser accepts must parse to exactly the same fields.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    const std::string raw(reinterpret_cast<const char*>(data), size);
+    const auto expected = reference_parse(raw);
+    try
+    {
+        const HttpRequest request(raw);
+        if (!expected || raw.empty())
+        {
+            return 0;
+        }
+        const auto& status = request.GetStatus();
+        // Methods other than GET and POST parse as RT_UNKNOWN and keep their token.
+        const t_request_type type = expected->method == "GET" ? t_request_type::RT_GET
+            : expected->method == "POST"                      ? t_request_type::RT_POST
+                                                              : t_request_type::RT_UNKNOWN;
+        const bool same = status.GetMethod() == type &&
+            status.GetRawMethod() == expected->method &&
+            status.GetTarget() == expected->target &&
+            to_string(status.GetVersion()) == expected->version &&
+            request.GetHeaders() == expected->headers && request.GetBody() == expected->body;
+        if (!same)
+        {
+            std::cerr << "Parser mismatch on well-formed request" << std::endl;
+            abort();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        if (expected)
+        {
+            std::cerr << "Well-formed request rejected: " << e.what() << std::endl;
+            abort();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Replays files (or every file in a directory) through a fuzz target. Used when
+// the compiler has no libFuzzer, so the corpus still runs as a regression check.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static void run_file(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    const std::vector<char> content((std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(content.data()), content.size());
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::filesystem::path path(argv[i]);
+        if (std::filesystem::is_directory(path))
+        {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+            {
+                if (entry.is_regular_file())
+                {
+                    run_file(entry.path());
+                    ++count;
+                }
+            }
+        }
+        else
+        {
+            run_file(path);
+            ++count;
+        }
+    }
+    std::cout << "Executed " << count << " input(s)" << std::endl;
+    return 0;
+}
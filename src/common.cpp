@@ -24,7 +24,7 @@ std::vector<std::string> split(const std::string& s)
             tokens.push_back(std::move(token));
         }
     }
-    if (s.back() == '/')
+    if (!s.empty() && s.back() == '/')
     {
         tokens.push_back("/");
     }
@@ -59,13 +59,15 @@ std::map<t_server_ctx, std::string> parse_args(int argc, char** argv)
     const option options[] =
     {
         {"directory", required_argument, NULL, 'd'},
+        {"workers", required_argument, NULL, 'w'},
+        {"config", required_argument, NULL, 'c'},
         {0, 0, 0, 0}
     };
     std::map<t_server_ctx, std::string> args;
     for (;;)
     {
         int i = 0;
-        int v = getopt_long(argc, argv, "d", options, &i);
+        int v = getopt_long(argc, argv, "d:w:c:", options, &i);
         if (v == -1)
         {
             break;
@@ -75,6 +77,12 @@ std::map<t_server_ctx, std::string> parse_args(int argc, char** argv)
             case 'd':
                 args[t_server_ctx::SC_DIRECTORY] = optarg;
                 break;
+            case 'w':
+                args[t_server_ctx::SC_WORKERS] = optarg;
+                break;
+            case 'c':
+                args[t_server_ctx::SC_CONFIG] = optarg;
+                break;
             default:
                 abort();
         }
@@ -9,6 +9,8 @@
 enum class t_server_ctx
 {
     SC_DIRECTORY = 0,
+    SC_WORKERS,
+    SC_CONFIG,
     SC_UNKNOWN
 };
 
@@ -0,0 +1,185 @@
+#include "config.hpp"
+#include <charconv>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+
+static std::string_view trim(std::string_view s)
+{
+    const auto begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos)
+    {
+        return {};
+    }
+    const auto end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+template<typename T>
+static T parse_number(std::string_view key, std::string_view value)
+{
+    T result{};
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc() || ptr != value.data() + value.size())
+    {
+        throw std::runtime_error("Invalid value for '" + std::string(key) + "': " +
+            std::string(value));
+    }
+    return result;
+}
+
+static bool parse_bool(std::string_view key, std::string_view value)
+{
+    if (value == "true" || value == "on" || value == "1")
+    {
+        return true;
+    }
+    if (value == "false" || value == "off" || value == "0")
+    {
+        return false;
+    }
+    throw std::runtime_error("Invalid value for '" + std::string(key) + "': " +
+        std::string(value));
+}
+
+static std::string parse_upstream(std::string_view key, std::string_view value)
+{
+    const auto colon = value.rfind(':');
+    if (colon == std::string_view::npos || colon == 0)
+    {
+        throw std::runtime_error("Invalid value for '" + std::string(key) +
+            "', expected host:port: " + std::string(value));
+    }
+    parse_number<uint16_t>(key, value.substr(colon + 1));
+    return std::string(value);
+}
+
+static t_proxy_balance parse_balance(std::string_view key, std::string_view value)
+{
+    if (value == "least_conn")
+    {
+        return t_proxy_balance::PB_LEAST_CONN;
+    }
+    if (value == "consistent_hash")
+    {
+        return t_proxy_balance::PB_CONSISTENT_HASH;
+    }
+    throw std::runtime_error("Invalid value for '" + std::string(key) + "': " +
+        std::string(value));
+}
+
+using t_setter = std::function<void(ServerConfig&, std::string_view, std::string_view)>;
+
+static const std::map<std::string_view, t_setter> g_config_keys =
+    {
+        {"listen_address", [](ServerConfig& c, std::string_view, std::string_view v)
+            { c.listen_address = v; }},
+        {"port", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.port = parse_number<uint16_t>(k, v); }},
+        {"workers", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.workers = parse_number<size_t>(k, v); }},
+        {"listen_backlog", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.listen_backlog = parse_number<int>(k, v); }},
+        {"recv_buffer_size", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.recv_buffer_size = parse_number<size_t>(k, v); }},
+        {"recv_timeout_ms", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.recv_timeout_ms = parse_number<int>(k, v); }},
+        {"shutdown_timeout_ms", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.shutdown_timeout_ms = parse_number<int>(k, v); }},
+        {"max_body_size", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.max_body_size = parse_number<size_t>(k, v); }},
+        {"log_requests", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.log_requests = parse_bool(k, v); }},
+        {"gzip_enabled", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.gzip_enabled = parse_bool(k, v); }},
+        {"gzip_min_size", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.gzip_min_size = parse_number<size_t>(k, v); }},
+        {"response_cache_entries", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.response_cache_entries = parse_number<size_t>(k, v); }},
+        {"response_cache_bytes", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.response_cache_bytes = parse_number<size_t>(k, v); }},
+        {"response_cache_ttl_ms", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.response_cache_ttl_ms = parse_number<int>(k, v); }},
+        {"rate_limit_rps", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.rate_limit_rps = parse_number<double>(k, v); }},
+        {"rate_limit_burst", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.rate_limit_burst = parse_number<double>(k, v); }},
+        {"rate_limit_table_size", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.rate_limit_table_size = parse_number<size_t>(k, v); }},
+        {"proxy_upstream", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.proxy_upstreams.push_back(parse_upstream(k, v)); }},
+        {"proxy_balance", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.proxy_balance = parse_balance(k, v); }},
+        {"proxy_max_idle", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.proxy_max_idle = parse_number<size_t>(k, v); }},
+        {"proxy_timeout_ms", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.proxy_timeout_ms = parse_number<int>(k, v); }},
+        {"proxy_retry_ms", [](ServerConfig& c, std::string_view k, std::string_view v)
+            { c.proxy_retry_ms = parse_number<int>(k, v); }},
+        {"directory", [](ServerConfig& c, std::string_view, std::string_view v)
+            { c.directory = v; }},
+    };
+
+ServerConfig load_config(const std::string& path, ServerConfig base)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open config file: " + path);
+    }
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(file, line))
+    {
+        ++line_no;
+        std::string_view view(line);
+        view = trim(view.substr(0, view.find('#')));
+        if (view.empty())
+        {
+            continue;
+        }
+        const auto eq = view.find('=');
+        if (eq == std::string_view::npos)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(line_no) +
+                ": expected 'key = value'");
+        }
+        const auto key = trim(view.substr(0, eq));
+        const auto value = trim(view.substr(eq + 1));
+        auto it = g_config_keys.find(key);
+        if (it == g_config_keys.end())
+        {
+            throw std::runtime_error(path + ":" + std::to_string(line_no) +
+                ": unknown key '" + std::string(key) + "'");
+        }
+        it->second(base, key, value);
+    }
+    if (base.recv_buffer_size < 2)
+    {
+        throw std::runtime_error("recv_buffer_size is too small");
+    }
+    return base;
+}
+
+ServerConfig make_config(const std::map<t_server_ctx, std::string>& args)
+{
+    ServerConfig config;
+    auto it = args.find(t_server_ctx::SC_CONFIG);
+    if (it != args.end())
+    {
+        config = load_config(it->second, config);
+    }
+    it = args.find(t_server_ctx::SC_DIRECTORY);
+    if (it != args.end())
+    {
+        config.directory = it->second;
+    }
+    it = args.find(t_server_ctx::SC_WORKERS);
+    if (it != args.end())
+    {
+        config.workers = parse_number<size_t>("workers", it->second);
+    }
+    return config;
+}
@@ -0,0 +1,59 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include "common.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class t_proxy_balance
+{
+    PB_LEAST_CONN = 0,
+    PB_CONSISTENT_HASH
+};
+
+// Flat, immutable server settings. A new instance is built on every (re)load and
+// published to the shards as a whole; nothing mutates a published config.
+struct ServerConfig
+{
+    std::string listen_address = "0.0.0.0";
+    uint16_t port = 4221;
+    size_t workers = 0; // 0 - one per available CPU
+    int listen_backlog = 128;
+    size_t recv_buffer_size = 1024;
+    int recv_timeout_ms = 0; // 0 - no timeout
+    // How long shutdown waits for requests in flight before exiting without cleanup.
+    int shutdown_timeout_ms = 5000;
+    size_t max_body_size = 8 * 1024 * 1024; // larger request bodies get 413
+    // Per-connection logging goes through the process-wide std::cout lock, so it is
+    // off by default.
+    bool log_requests = false;
+    bool gzip_enabled = true;
+    size_t gzip_min_size = 0;
+    // Per-shard response cache; capacity is fixed at startup, the TTL is reloadable.
+    size_t response_cache_entries = 1024; // 0 - cache disabled
+    size_t response_cache_bytes = 4 * 1024 * 1024;
+    int response_cache_ttl_ms = 1000;
+    // Per-client-IP token buckets, checked before the request is read.
+    double rate_limit_rps = 0; // 0 - rate limiting disabled
+    double rate_limit_burst = 20;
+    size_t rate_limit_table_size = 65536; // fixed at startup
+    // Upstreams for the /proxy route, "host:port" each; one per proxy_upstream line.
+    std::vector<std::string> proxy_upstreams;
+    t_proxy_balance proxy_balance = t_proxy_balance::PB_LEAST_CONN;
+    size_t proxy_max_idle = 8; // idle keep-alive connections per upstream and shard
+    int proxy_timeout_ms = 5000;
+    int proxy_retry_ms = 1000; // how long an unreachable upstream is skipped
+    std::string directory;
+};
+
+// Reads "key = value" lines ('#' starts a comment) on top of `base`.
+// Throws std::runtime_error on unreadable files, unknown keys or bad values.
+ServerConfig load_config(const std::string& path, ServerConfig base = {});
+
+// Defaults, then the file given by --config, then the remaining command line options.
+ServerConfig make_config(const std::map<t_server_ctx, std::string>& args);
+
+#endif // !CONFIG_HPP
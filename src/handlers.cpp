@@ -8,6 +8,18 @@ static const std::string g_not_found_response = "HTTP/1.1 404 Not Found\r\n\r\n"
 static const std::string g_server_error_response = "HTTP/1.1 500 Internal Server Error\r\n\r\n";
 static const std::unordered_set<std::string> g_headers = {"test_example.html"};
 
+static bool use_gzip(const HttpRequest& request, const ServerContext& ctx, size_t size)
+{
+    const ServerConfig& config = ctx.GetConfig();
+    if (!config.gzip_enabled || size < config.gzip_min_size)
+    {
+        return false;
+    }
+    const auto& headers = request.GetHeaders();
+    auto encoding = headers.find("Accept-Encoding");
+    return encoding != headers.end() && encoding->second.find("gzip") != std::string::npos;
+}
+
 struct RootHandler
 {
     static HttpResponse Handle(const HttpRequest& request, const ServerContext& ctx)
@@ -37,7 +49,7 @@ struct FileHandler
             case t_request_type::RT_POST:
                 return handle_post(path + '/' + target[3], request);
             case t_request_type::RT_GET:
-                return handle_get(path + '/' + target[3], request);
+                return handle_get(path + '/' + target[3], request, ctx);
             default:
                 return HttpResponse(t_response_answer::RT_NOT_FOUND, t_http_version::HV_1_1);
         }
@@ -59,9 +71,9 @@ private:
         }
         return HttpResponse(t_response_answer::RT_CREATED, t_http_version::HV_1_1);
     }
-    static HttpResponse handle_get(const std::string& path, const HttpRequest& request)
+    static HttpResponse handle_get(const std::string& path, const HttpRequest& request,
+        const ServerContext& ctx)
     {
-        const auto& headers = request.GetHeaders();
         const std::string file = read_file(path);
         if (file.empty())
         {
@@ -70,9 +82,7 @@ private:
         HttpResponse response(t_response_answer::RT_OK, t_http_version::HV_1_1);
         response.SetContentType("application/octet-stream");
         response.SetContentLength(file.size());
-        auto encoding = headers.find("Accept-Encoding");
-        //TODO: add encoding to server ctx
-        if (encoding != headers.end() && encoding->second.find("gzip") != std::string::npos)
+        if (use_gzip(request, ctx, file.size()))
         {
             response.SetEncoding("gzip");
         }
@@ -95,10 +105,7 @@ struct EchoHandler
             }
             HttpResponse response(t_response_answer::RT_OK, t_http_version::HV_1_1);
             response.SetContentType("text/plain");
-            const auto& headers = request.GetHeaders();
-            auto encoding = headers.find("Accept-Encoding");
-            if (encoding != headers.end() &&
-                encoding->second.find("gzip") != std::string::npos)
+            if (use_gzip(request, ctx, targets[3].size()))
             {
                 response.SetEncoding("gzip");
             }
@@ -126,9 +133,7 @@ struct UserAgentHandler
             HttpResponse response(t_response_answer::RT_OK, t_http_version::HV_1_1);
             response.SetContentType("text/plain");
             response.SetContentLength(userAgent->second.size());
-            auto encoding = headers.find("Accept-Encoding");
-            if (encoding != headers.end() &&
-                encoding->second.find("gzip") != std::string::npos)
+            if (use_gzip(request, ctx, userAgent->second.size()))
             {
                 response.SetEncoding("gzip");
             }
@@ -160,10 +165,7 @@ struct HtmlHandler
         HttpResponse response(t_response_answer::RT_OK, t_http_version::HV_1_1);
         response.SetContentType("text/html");
         response.SetContentLength(data.size());
-        const auto& headers = request.GetHeaders();
-        auto encoding = headers.find("Accept-Encoding");
-        if (encoding != headers.end() &&
-            encoding->second.find("gzip") != std::string::npos)
+        if (use_gzip(request, ctx, data.size()))
         {
             response.SetEncoding("gzip");
         }
@@ -172,29 +174,118 @@ struct HtmlHandler
     }
 };
 
-static std::map<std::string, std::function<HttpResponse(const HttpRequest&, const ServerContext&)> >g_router_map =
+// Forwards /proxy/<path> to one of the configured upstreams as /<path>.
+struct ProxyHandler
+{
+    static std::string Handle(const HttpRequest& request, const ServerContext& ctx)
+    {
+        UpstreamPool* pool = ctx.GetUpstreamPool();
+        if (pool == nullptr)
+        {
+            return HttpResponse(t_response_answer::RT_NOT_FOUND, t_http_version::HV_1_1).str();
+        }
+        const auto& target = request.GetStatus().GetTarget();
+        std::string path;
+        for (size_t i = 2; i < target.size(); ++i)
+        {
+            path += target[i];
+        }
+        if (path.empty())
+        {
+            path = "/";
+        }
+        return pool->Forward(ctx.GetConfig(), path, request);
+    }
+};
+
+using t_handler = std::function<HttpResponse(const HttpRequest&, const ServerContext&)>;
+// Produces the wire bytes itself, e.g. when relaying an upstream response as is.
+using t_raw_handler = std::function<std::string(const HttpRequest&, const ServerContext&)>;
+
+struct Route
+{
+    t_handler handler = nullptr;
+    // Opt-in response caching for GET requests. The cache key is the method, the
+    // normalized path and the values of the `vary` request headers.
+    bool cacheable = false;
+    std::vector<std::string> vary = {};
+    t_raw_handler raw_handler = nullptr;
+};
+
+static std::map<std::string, Route> g_router_map =
     {
-        {"/", RootHandler::Handle},
-        {"/echo", EchoHandler::Handle},
-        {"/files", FileHandler::Handle},
-        {"/user-agent", UserAgentHandler::Handle},
-        {"/test_example.html", HtmlHandler::Handle}
+        {"/", {RootHandler::Handle}},
+        {"/echo", {EchoHandler::Handle, true, {"Accept-Encoding"}}},
+        {"/files", {FileHandler::Handle}},
+        {"/user-agent", {UserAgentHandler::Handle, true, {"User-Agent", "Accept-Encoding"}}},
+        {"/test_example.html", {HtmlHandler::Handle}},
+        {"/proxy", {nullptr, false, {}, ProxyHandler::Handle}}
     };
 
-HttpResponse handle_http_request(const HttpRequest& request, const ServerContext& ctx)
+static std::string make_cache_key(const HttpRequest& request, const Route& route)
+{
+    const auto& status = request.GetStatus();
+    std::string key = to_string(status.GetMethod());
+    key += ' ';
+    for (const auto& part : status.GetTarget())
+    {
+        key += part;
+    }
+    const auto& headers = request.GetHeaders();
+    for (const auto& name : route.vary)
+    {
+        key += '\n';
+        auto it = headers.find(name);
+        if (it != headers.end())
+        {
+            key += '=';
+            key += it->second;
+        }
+    }
+    return key;
+}
+
+std::string handle_http_request(const HttpRequest& request, const ServerContext& ctx)
 {
     const auto& status = request.GetStatus();
     const auto& target = status.GetTarget();
     if (target.empty())
     {
-        return HttpResponse(t_response_answer::RT_NOT_FOUND, t_http_version::HV_1_1);
+        return HttpResponse(t_response_answer::RT_NOT_FOUND, t_http_version::HV_1_1).str();
     }
-    const auto& headers = request.GetHeaders();
     const std::string key = target[0] + (target.size() > 1 ? target[1] : "");
     const auto& route = g_router_map.find(key);
-    if (route != g_router_map.end())
+    if (route == g_router_map.end())
+    {
+        return HttpResponse(t_response_answer::RT_NOT_FOUND, t_http_version::HV_1_1).str();
+    }
+    if (route->second.raw_handler)
+    {
+        return route->second.raw_handler(request, ctx);
+    }
+    if (status.GetMethod() == t_request_type::RT_UNKNOWN)
+    {
+        HttpResponse response(t_response_answer::RT_NOT_IMPLEMENTED, t_http_version::HV_1_1);
+        response.SetContentLength(0);
+        return response.str();
+    }
+    ResponseCache* cache = ctx.GetResponseCache();
+    if (cache == nullptr || !route->second.cacheable ||
+        status.GetMethod() != t_request_type::RT_GET)
+    {
+        return route->second.handler(request, ctx).str();
+    }
+    const std::string cache_key = make_cache_key(request, route->second);
+    if (auto cached = cache->Find(cache_key))
+    {
+        return *cached;
+    }
+    HttpResponse response = route->second.handler(request, ctx);
+    std::string bytes = response.str();
+    if (response.GetType() == t_response_answer::RT_OK)
     {
-        return route->second(request, ctx);
+        cache->Insert(cache_key, bytes,
+            std::chrono::milliseconds(ctx.GetConfig().response_cache_ttl_ms));
     }
-    return HttpResponse(t_response_answer::RT_NOT_FOUND, t_http_version::HV_1_1);
+    return bytes;
 }
@@ -5,6 +5,8 @@
 #include "http_response.hpp"
 #include "server_context.hpp"
 
-HttpResponse handle_http_request(const HttpRequest& request, const ServerContext& ctx);
+// Routes the request and returns the serialized response, served from the shard's
+// response cache when the route allows it.
+std::string handle_http_request(const HttpRequest& request, const ServerContext& ctx);
 
 #endif
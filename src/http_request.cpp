@@ -1,16 +1,24 @@
 #include "http_request.hpp"
+#include <algorithm>
 #include <string>
 
 t_request_type get_request_type(const std::string& request)
 {
-    if (request.find("POST") != std::string::npos)
+    if (request == "POST")
     {
         return t_request_type::RT_POST;
     }
-    if (request.find("GET") != std::string::npos)
+    if (request == "GET")
     {
         return t_request_type::RT_GET;
     }
+    // Other well-formed methods (PUT, DELETE, ...) parse, but no local handler
+    // serves them; the proxy forwards them by name.
+    if (!request.empty() && std::all_of(request.begin(), request.end(),
+            [](char c) { return c >= 'A' && c <= 'Z'; }))
+    {
+        return t_request_type::RT_UNKNOWN;
+    }
     throw std::invalid_argument("Invalid request type");
 }
 
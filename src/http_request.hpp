@@ -33,9 +33,8 @@ public:
     RequestStatus(const std::string& parsed_request)
     {
         std::istringstream ss(parsed_request);
-        std::string rawMethod;
-        ss >> rawMethod;
-        m_method = get_request_type(rawMethod);
+        ss >> m_raw_method;
+        m_method = get_request_type(m_raw_method);
         std::string rawTarget;
         ss >> rawTarget;
         m_target = split(rawTarget);
@@ -47,6 +46,11 @@ public:
     {
         return m_method;
     }
+    // The method token as sent, also for methods that map to RT_UNKNOWN.
+    const std::string& GetRawMethod() const
+    {
+        return m_raw_method;
+    }
     std::vector<std::string> GetTarget() const
     {
         return m_target;
@@ -57,7 +61,7 @@ public:
     }
     friend std::ostream& operator<<(std::ostream& os, RequestStatus requestLine)
     {
-        os << "Method: " << to_string(requestLine.m_method) << std::endl;
+        os << "Method: " << requestLine.m_raw_method << std::endl;
         os << "Target: ";
         for (const auto& target : requestLine.m_target)
         {
@@ -69,6 +73,7 @@ public:
     }
 private:
     t_request_type m_method;
+    std::string m_raw_method;
     std::vector<std::string> m_target;
     t_http_version m_version;
 };
@@ -86,10 +91,10 @@ public:
             }
             m_request_line = RequestStatus(rawRequest.substr(0, idx));
             m_headers = ParseHeaders(rawRequest.substr(idx + 2));
-            auto end = rawRequest.find_last_of("\r\n\r\n");
+            auto end = rawRequest.find("\r\n\r\n", idx);
             if (end != std::string::npos)
             {
-                m_body = rawRequest.substr(end + 1);
+                m_body = rawRequest.substr(end + 4);
             }
         }
     }
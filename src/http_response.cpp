@@ -8,10 +8,22 @@ std::string to_string(t_response_answer type)
             return "200 OK";
         case t_response_answer::RT_CREATED:
             return "201 Created";
+        case t_response_answer::RT_BAD_REQUEST:
+            return "400 Bad Request";
         case t_response_answer::RT_NOT_FOUND:
             return "404 Not Found";
+        case t_response_answer::RT_PAYLOAD_TOO_LARGE:
+            return "413 Payload Too Large";
+        case t_response_answer::RT_TOO_MANY_REQUESTS:
+            return "429 Too Many Requests";
         case t_response_answer::RT_SERVER_ERROR:
             return "500 Internal Server Error";
+        case t_response_answer::RT_NOT_IMPLEMENTED:
+            return "501 Not Implemented";
+        case t_response_answer::RT_BAD_GATEWAY:
+            return "502 Bad Gateway";
+        case t_response_answer::RT_GATEWAY_TIMEOUT:
+            return "504 Gateway Timeout";
         default:
             return "UNKNOWN";
     }
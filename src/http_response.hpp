@@ -11,8 +11,14 @@ enum t_response_answer
 {
     RT_OK = 0,
     RT_CREATED,
+    RT_BAD_REQUEST,
     RT_NOT_FOUND,
-    RT_SERVER_ERROR
+    RT_PAYLOAD_TOO_LARGE,
+    RT_TOO_MANY_REQUESTS,
+    RT_SERVER_ERROR,
+    RT_NOT_IMPLEMENTED,
+    RT_BAD_GATEWAY,
+    RT_GATEWAY_TIMEOUT
 };
 
 std::string to_string(t_response_answer type);
@@ -39,6 +45,10 @@ public:
         }
         return ss.str();
     }
+    t_response_answer GetType() const
+    {
+        return m_type;
+    }
     void SetContentLength(size_t length)
     {
         m_headers["Content-Length"] = std::to_string(length);
@@ -51,6 +61,10 @@ public:
     {
         m_headers["Content-Encoding"] = encoding;
     }
+    void SetRetryAfter(uint32_t seconds)
+    {
+        m_headers["Retry-After"] = std::to_string(seconds);
+    }
     void SetBody(const std::string& body)
     {
         m_body = body;
@@ -0,0 +1,167 @@
+#include "rate_limiter.hpp"
+#include <algorithm>
+#include <cmath>
+
+static constexpr uint64_t g_ip_mask = 0xFFFFFFFFull;
+static constexpr uint64_t g_used_bit = uint64_t(1) << 32;
+static constexpr uint64_t g_reserved_bit = uint64_t(1) << 33;
+static constexpr unsigned g_generation_shift = 56;
+
+static constexpr unsigned g_token_bits = 20;
+static constexpr uint64_t g_token_mask = (uint64_t(1) << g_token_bits) - 1;
+static constexpr uint64_t g_token_unit = 256;
+static constexpr unsigned g_time_bits = 36;
+static constexpr uint64_t g_time_mask = (uint64_t(1) << g_time_bits) - 1;
+static constexpr size_t g_probe_window = 8;
+
+static uint64_t generation_of(uint64_t word)
+{
+    return word >> g_generation_shift;
+}
+
+static uint64_t pack(uint64_t generation, uint64_t ms, uint64_t tokens)
+{
+    return (generation << g_generation_shift) | ((ms & g_time_mask) << g_token_bits) |
+        tokens;
+}
+
+static uint64_t time_of(uint64_t state)
+{
+    return (state >> g_token_bits) & g_time_mask;
+}
+
+// Milliseconds from `last` to `now` on the wrapping 36-bit clock.
+static uint64_t elapsed(uint64_t last, uint64_t now)
+{
+    return (now - last) & g_time_mask;
+}
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t result = g_probe_window;
+    while (result < n)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+RateLimiter::RateLimiter(size_t slots)
+    : m_slots(round_up_pow2(slots)), m_mask(m_slots.size() - 1),
+      m_start(std::chrono::steady_clock::now())
+{
+}
+
+uint64_t RateLimiter::Now() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_start).count() & g_time_mask;
+}
+
+// Takes `slot` over from its current key word `expected`. Fails if another thread
+// changed the slot first.
+bool RateLimiter::Claim(Slot& slot, uint64_t expected, uint64_t key, uint64_t now,
+    uint64_t full, uint64_t& generation)
+{
+    generation = (generation_of(expected) + 1) & 0xFF;
+    const uint64_t reserved = (generation << g_generation_shift) | g_reserved_bit;
+    if (!slot.key.compare_exchange_strong(expected, reserved, std::memory_order_acq_rel))
+    {
+        return false;
+    }
+    slot.state.store(pack(generation, now, full), std::memory_order_relaxed);
+    slot.key.store((generation << g_generation_shift) | key, std::memory_order_release);
+    return true;
+}
+
+RateLimiter::Slot* RateLimiter::FindSlot(uint64_t key, uint64_t now, uint64_t full,
+    uint64_t& generation)
+{
+    const size_t start = ((key * 0x9E3779B97F4A7C15ull) >> 32) & m_mask;
+    Slot* oldest = nullptr;
+    uint64_t oldest_word = 0;
+    uint64_t oldest_age = 0;
+    for (size_t i = 0; i < g_probe_window; ++i)
+    {
+        Slot& slot = m_slots[(start + i) & m_mask];
+        const uint64_t current = slot.key.load(std::memory_order_acquire);
+        if ((current & (g_used_bit | g_ip_mask)) == key && !(current & g_reserved_bit))
+        {
+            generation = generation_of(current);
+            return &slot;
+        }
+        if (!(current & g_used_bit) && !(current & g_reserved_bit))
+        {
+            // Empty slot; if someone else claims it first, probe again.
+            return Claim(slot, current, key, now, full, generation) ? &slot : nullptr;
+        }
+        if (current & g_reserved_bit)
+        {
+            // Possibly our own key being installed by another thread. Retry instead
+            // of claiming a second slot for the same client.
+            return nullptr;
+        }
+        const uint64_t state = slot.state.load(std::memory_order_relaxed);
+        const uint64_t age = elapsed(time_of(state), now);
+        if (oldest == nullptr || age > oldest_age)
+        {
+            oldest = &slot;
+            oldest_word = current;
+            oldest_age = age;
+        }
+    }
+    // Window is full: take over the least recently used bucket. A client that
+    // loses its bucket this way simply starts again with a full one.
+    return Claim(*oldest, oldest_word, key, now, full, generation) ? oldest : nullptr;
+}
+
+uint32_t RateLimiter::Acquire(uint32_t client_ip, double rate, double burst)
+{
+    if (rate <= 0)
+    {
+        return 0;
+    }
+    const uint64_t now = Now();
+    const uint64_t full = std::min<uint64_t>(std::max(burst, 1.0) * g_token_unit,
+        g_token_mask);
+    const uint64_t key = g_used_bit | client_ip;
+    for (;;)
+    {
+        uint64_t generation = 0;
+        Slot* slot = FindSlot(key, now, full, generation);
+        if (slot == nullptr)
+        {
+            continue;
+        }
+        uint64_t old_state = slot->state.load(std::memory_order_acquire);
+        // A generation mismatch means the slot changed owner since FindSlot; look
+        // the key up again rather than touch someone else's bucket.
+        while (generation_of(old_state) == generation)
+        {
+            const uint64_t last = time_of(old_state);
+            uint64_t delta = elapsed(last, now);
+            // Another thread may already have stored a slightly later time.
+            const bool stale_now = delta > g_time_mask / 2;
+            if (stale_now)
+            {
+                delta = 0;
+            }
+            const double refill = delta * rate * g_token_unit / 1000.0;
+            const uint64_t tokens = std::min<double>(full,
+                (old_state & g_token_mask) + refill);
+            if (tokens < g_token_unit)
+            {
+                const double wait_ms = (g_token_unit - tokens) * 1000.0 /
+                    (rate * g_token_unit);
+                return std::max<uint32_t>(1, std::ceil(wait_ms / 1000.0));
+            }
+            const uint64_t new_state = pack(generation, stale_now ? last : now,
+                tokens - g_token_unit);
+            if (slot->state.compare_exchange_weak(old_state, new_state,
+                    std::memory_order_acq_rel))
+            {
+                return 0;
+            }
+        }
+    }
+}
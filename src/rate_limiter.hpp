@@ -0,0 +1,52 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-client token buckets in a fixed-size, open-addressed table. Lookups and
+// token updates are lock-free (CAS on a single word per bucket). When every slot
+// in a key's probe window is taken, the bucket that was touched least recently
+// is handed over to the new key, which gives approximate-LRU reclamation. The table
+// is shared by all shards so that a client is limited as a whole, no matter which
+// listener its connections land on.
+//
+// A slot changes owner in three steps: its key word is CAS-ed to a reserved
+// marker, the bucket is reset, and only then is the new key published. Lookups
+// that meet a reserved slot retry, so one client never ends up with two buckets.
+// Both words carry the same 8-bit generation, so a thread that still holds the
+// previous owner's state can no longer CAS it, and nobody can see the new key
+// before its bucket is reset.
+class RateLimiter
+{
+public:
+    explicit RateLimiter(size_t slots);
+
+    // Takes one token from the client's bucket. Returns 0 if the request may
+    // proceed, otherwise the number of seconds until a token becomes available.
+    // Bursts are capped at 4095 tokens.
+    uint32_t Acquire(uint32_t client_ip, double rate, double burst);
+private:
+    // key:   [generation : 8][unused : 22][reserved : 1][used : 1][client ip : 32]
+    // state: [generation : 8][ms since start, wrapping : 36][tokens in 1/256 : 20]
+    struct Slot
+    {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> state{0};
+    };
+
+    Slot* FindSlot(uint64_t key, uint64_t now, uint64_t full, uint64_t& generation);
+    bool Claim(Slot& slot, uint64_t expected, uint64_t key, uint64_t now, uint64_t full,
+        uint64_t& generation);
+    uint64_t Now() const;
+
+private:
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // !RATE_LIMITER_HPP
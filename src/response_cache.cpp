@@ -0,0 +1,119 @@
+#include "response_cache.hpp"
+
+ResponseCache::ResponseCache(size_t max_entries, size_t max_bytes)
+    : m_slots(max_entries), m_max_bytes(max_bytes)
+{
+    m_index.reserve(max_entries);
+    m_free.reserve(max_entries);
+    for (size_t slot = max_entries; slot > 0; --slot)
+    {
+        m_free.push_back(slot - 1);
+    }
+}
+
+std::shared_ptr<const std::string> ResponseCache::Find(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        return nullptr;
+    }
+    Entry& entry = m_slots[it->second];
+    if (entry.expires <= t_clock::now())
+    {
+        Erase(it->second);
+        return nullptr;
+    }
+    entry.referenced = true;
+    return entry.bytes;
+}
+
+void ResponseCache::Insert(const std::string& key, std::string bytes,
+    std::chrono::milliseconds ttl)
+{
+    if (m_slots.empty() || bytes.size() > m_max_bytes || ttl.count() <= 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        Erase(it->second);
+    }
+    while (m_free.empty() || m_bytes + bytes.size() > m_max_bytes)
+    {
+        Evict();
+    }
+    const size_t slot = m_free.back();
+    m_free.pop_back();
+    Entry& entry = m_slots[slot];
+    m_bytes += bytes.size();
+    entry.key = key;
+    entry.bytes = std::make_shared<const std::string>(std::move(bytes));
+    entry.expires = t_clock::now() + ttl;
+    entry.referenced = false;
+    entry.used = true;
+    m_index.emplace(key, slot);
+}
+
+void ResponseCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t slot = 0; slot < m_slots.size(); ++slot)
+    {
+        if (m_slots[slot].used)
+        {
+            Erase(slot);
+        }
+    }
+}
+
+size_t ResponseCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.size();
+}
+
+size_t ResponseCache::Bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+void ResponseCache::Erase(size_t slot)
+{
+    Entry& entry = m_slots[slot];
+    m_index.erase(entry.key);
+    m_bytes -= entry.bytes->size();
+    entry.key.clear();
+    entry.bytes.reset();
+    entry.referenced = false;
+    entry.used = false;
+    m_free.push_back(slot);
+}
+
+// Advances the clock hand until it finds a used entry that has not been
+// referenced since the last sweep (or has expired) and frees it.
+void ResponseCache::Evict()
+{
+    const auto now = t_clock::now();
+    for (;;)
+    {
+        const size_t slot = m_hand;
+        m_hand = (m_hand + 1) % m_slots.size();
+        Entry& entry = m_slots[slot];
+        if (!entry.used)
+        {
+            continue;
+        }
+        if (entry.referenced && entry.expires > now)
+        {
+            entry.referenced = false;
+            continue;
+        }
+        Erase(slot);
+        return;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Fixed-capacity cache of serialized responses with per-entry TTL and CLOCK
+// (second chance) eviction. Bounded both by entry count and by total bytes.
+// One instance lives in each shard, so the lock is only contended by the
+// connections of that shard.
+class ResponseCache
+{
+public:
+    using t_clock = std::chrono::steady_clock;
+
+    ResponseCache(size_t max_entries, size_t max_bytes);
+
+    // Returns the cached wire bytes, or nullptr on a miss or an expired entry.
+    std::shared_ptr<const std::string> Find(const std::string& key);
+    void Insert(const std::string& key, std::string bytes, std::chrono::milliseconds ttl);
+    // Drops every entry, e.g. when a new config may change how responses are built.
+    void Clear();
+    size_t Size() const;
+    size_t Bytes() const;
+private:
+    struct Entry
+    {
+        std::string key;
+        std::shared_ptr<const std::string> bytes;
+        t_clock::time_point expires;
+        bool referenced = false;
+        bool used = false;
+    };
+
+    void Erase(size_t slot);
+    void Evict();
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<Entry> m_slots;
+    std::unordered_map<std::string, size_t> m_index;
+    std::vector<size_t> m_free;
+    size_t m_hand = 0;
+    size_t m_max_bytes;
+    size_t m_bytes = 0;
+};
+
+#endif // !RESPONSE_CACHE_HPP
@@ -1,44 +1,58 @@
-#include "http_request.hpp"
-#include "handlers.hpp"
+#include "config.hpp"
+#include "rate_limiter.hpp"
+#include "shard.hpp"
+#include <csignal>
 #include <cstdlib>
-#include <cstring>
 #include <iostream>
-#include <mutex>
-#include <string>
-#include <thread>
-#include <netdb.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <unistd.h>
+#include <memory>
+#include <vector>
+#include <pthread.h>
 
-constexpr uint16_t g_port = 4221;
-
-std::string parse_request(const std::string& request, const ServerContext& ctx)
+// Rebuilds the config from the same sources as at startup and publishes it to
+// every shard. Listening sockets and the shard count are fixed at startup.
+static void reload_config(const std::map<t_server_ctx, std::string>& args,
+    const ServerConfig& current, std::vector<std::unique_ptr<Shard>>& shards)
 {
-    HttpRequest req(request);
-    std::cout << "REQUEST: " << req << std::endl;
-    return handle_http_request(req, ctx).str();
+    std::shared_ptr<const ServerConfig> config;
+    try
+    {
+        config = std::make_shared<const ServerConfig>(make_config(args));
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Config reload failed, keeping previous config: " << e.what()
+                  << std::endl;
+        return;
+    }
+    if (config->listen_address != current.listen_address || config->port != current.port ||
+        config->workers != current.workers || config->listen_backlog != current.listen_backlog ||
+        config->response_cache_entries != current.response_cache_entries ||
+        config->response_cache_bytes != current.response_cache_bytes ||
+        config->rate_limit_table_size != current.rate_limit_table_size)
+    {
+        std::cerr << "Listener, worker, cache size and rate limit table settings require a "
+                     "restart and are ignored"
+                  << std::endl;
+    }
+    for (auto& shard : shards)
+    {
+        shard->Publish(config);
+    }
+    std::cout << "Config reloaded" << std::endl;
 }
 
-std::mutex request_mutex;
-
-void handle_client(int client_fd, const ServerContext& ctx)
+static void print_stats(const std::vector<std::unique_ptr<Shard>>& shards)
 {
-    std::string request;
-    request.resize(1024);
-    const ssize_t bytes_read = recv(client_fd, request.data(), request.size() - 1, 0);
-    if (bytes_read < 0)
+    for (const auto& shard : shards)
     {
-        std::cerr << "Failed to read from client\n";
-        close(client_fd);
-        return;
+        const ShardStats& stats = shard->GetStats();
+        std::cout << "shard " << shard->GetId() << " cpu " << shard->GetCpu()
+                  << ": accepted " << stats.accepted.load(std::memory_order_relaxed)
+                  << ", requests " << stats.requests.load(std::memory_order_relaxed)
+                  << ", errors " << stats.errors.load(std::memory_order_relaxed)
+                  << ", rate_limited " << stats.rate_limited.load(std::memory_order_relaxed)
+                  << std::endl;
     }
-    request[bytes_read] = '\0';
-    const std::string response =
-        parse_request(request, ctx);
-    send(client_fd, response.data(), response.size(), 0);
-    close(client_fd);
 }
 
 int main(int argc, char** argv)
@@ -46,59 +60,104 @@ int main(int argc, char** argv)
     // Flush after every std::cout / std::cerr
     std::cout << std::unitbuf;
     std::cerr << std::unitbuf;
-    ServerContext ctx(parse_args(argc, argv));
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0)
+    const auto args = parse_args(argc, argv);
+    std::shared_ptr<const ServerConfig> config;
+    try
     {
-        std::cerr << "Failed to create server socket\n";
-        return 1;
+        config = std::make_shared<const ServerConfig>(make_config(args));
     }
-
-    int reuse = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+    catch (const std::exception& e)
     {
-        std::cerr << "Setsockopt failed\n";
+        std::cerr << e.what() << std::endl;
         return 1;
     }
 
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(g_port);
+    // Block the control signals before any thread is started so that only the main
+    // thread receives them, through sigwait below. SIGHUP reloads the config,
+    // SIGUSR1 prints the per-shard stats, SIGUSR2 is raised by a shard whose accept
+    // loop died and SIGINT/SIGTERM shut the server down.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGUSR2);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
-    if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) != 0)
+    const std::vector<int> cpus = available_cpus();
+    const size_t workers = config->workers != 0 ? config->workers : cpus.size();
+
+    std::unique_ptr<RateLimiter> limiter;
+    if (config->rate_limit_table_size > 0)
     {
-        std::cerr << "Failed to bind to port " << g_port << std::endl;
-        return 1;
+        limiter = std::make_unique<RateLimiter>(config->rate_limit_table_size);
     }
 
-    int connection_backlog = 5;
-    if (listen(server_fd, connection_backlog) != 0)
+    std::vector<std::unique_ptr<Shard>> shards;
+    shards.reserve(workers);
+    for (size_t i = 0; i < workers; ++i)
     {
-        std::cerr << "Listen failed\n";
-        return 1;
+        auto shard = std::make_unique<Shard>(i, cpus[i % cpus.size()], config,
+            limiter.get());
+        if (!shard->Listen())
+        {
+            return 1;
+        }
+        shards.push_back(std::move(shard));
     }
 
-    struct sockaddr_in client_addr;
-    int client_addr_len = sizeof(client_addr);
-
-    std::cout << "Server listening on port " << g_port << std::endl;
+    std::cout << "Server listening on port " << config->port << " with " << shards.size()
+              << " shard(s)" << std::endl;
 
-    while (true)
+    for (auto& shard : shards)
     {
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr,
-            (socklen_t*)&client_addr_len);
-        if (client_fd < 0)
+        shard->Start();
+    }
+    int exit_code = 0;
+    for (bool running = true; running;)
+    {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0)
         {
-            std::cerr << "Accept failed\n";
+            exit_code = 1;
             break;
         }
-
-        std::cout << "Client connected " << inet_ntoa(client_addr.sin_addr) << std::endl;
-        std::thread client_thread(handle_client, client_fd, ctx);
-        client_thread.detach();
+        switch (signal)
+        {
+            case SIGHUP:
+                reload_config(args, *config, shards);
+                break;
+            case SIGUSR1:
+                print_stats(shards);
+                break;
+            case SIGUSR2:
+                std::cerr << "A shard stopped accepting connections, shutting down"
+                          << std::endl;
+                exit_code = 1;
+                running = false;
+                break;
+            default:
+                running = false;
+                break;
+        }
     }
-
-    close(server_fd);
-    return 0;
+    for (auto& shard : shards)
+    {
+        shard->Stop();
+    }
+    bool drained = true;
+    for (auto& shard : shards)
+    {
+        drained = shard->Join() && drained;
+    }
+    if (!drained)
+    {
+        // Connection threads still use the shards; destroying them would pull the
+        // cache, upstream pool and stats out from under those threads.
+        std::cerr << "Requests still in flight after shutdown_timeout_ms, exiting"
+                  << std::endl;
+        std::_Exit(exit_code);
+    }
+    return exit_code;
 }
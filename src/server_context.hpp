@@ -1,28 +1,48 @@
 #ifndef SERVER_CONTEXT_HPP
 #define SERVER_CONTEXT_HPP
 
+#include "config.hpp"
+#include "response_cache.hpp"
+#include "upstream_pool.hpp"
+#include <memory>
 #include <string>
-#include "common.hpp"
-#include <map>
 
+// Per-connection view of the configuration. It pins the config snapshot that was
+// current when the connection was accepted, so a reload never changes settings
+// under a request that is already being served.
 class ServerContext
 {
 public:
-    ServerContext() = default;
-    ServerContext(const std::map<t_server_ctx, std::string>& args) : m_ctx(args)
+    ServerContext() : m_config(std::make_shared<const ServerConfig>())
     {
     }
-    std::string GetDirectory() const
+    explicit ServerContext(std::shared_ptr<const ServerConfig> config,
+        ResponseCache* cache = nullptr, UpstreamPool* upstreams = nullptr)
+        : m_config(std::move(config)), m_cache(cache), m_upstreams(upstreams)
     {
-        auto it = m_ctx.find(t_server_ctx::SC_DIRECTORY);
-        if (it != m_ctx.end())
-        {
-            return it->second;
-        }
-        return {};
+    }
+    const ServerConfig& GetConfig() const
+    {
+        return *m_config;
+    }
+    const std::string& GetDirectory() const
+    {
+        return m_config->directory;
+    }
+    // Response cache of the shard serving the connection, or nullptr if disabled.
+    ResponseCache* GetResponseCache() const
+    {
+        return m_cache;
+    }
+    // Upstream connection pool of the shard serving the connection.
+    UpstreamPool* GetUpstreamPool() const
+    {
+        return m_upstreams;
     }
 private:
-    std::map<t_server_ctx, std::string> m_ctx;
+    std::shared_ptr<const ServerConfig> m_config;
+    ResponseCache* m_cache = nullptr;
+    UpstreamPool* m_upstreams = nullptr;
 };
 
 #endif // !SERVER_CONTEXT_HPP
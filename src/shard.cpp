@@ -0,0 +1,410 @@
+#include "shard.hpp"
+#include "handlers.hpp"
+#include "http_request.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static std::string error_response(t_response_answer type)
+{
+    HttpResponse response(type, t_http_version::HV_1_1);
+    response.SetContentLength(0);
+    return response.str();
+}
+
+// Appends what the client sends next, up to `limit` bytes in total. Returns false
+// on EOF, timeout (SO_RCVTIMEO) or error.
+static bool recv_more(int fd, std::string& request, size_t limit)
+{
+    const size_t size = request.size();
+    request.resize(limit);
+    ssize_t n;
+    do
+    {
+        n = recv(fd, request.data() + size, limit - size, 0);
+    } while (n < 0 && errno == EINTR);
+    request.resize(size + std::max<ssize_t>(n, 0));
+    return n > 0;
+}
+
+// Reads the request head, at most recv_buffer_size bytes, and then the body up to
+// its Content-Length. Returns RT_OK once `request` holds the whole request, or the
+// status to reply with; `request` stays empty if the client sent nothing.
+static t_response_answer read_request(int fd, const ServerConfig& config,
+    std::string& request)
+{
+    size_t head_end;
+    size_t scanned = 0;
+    while ((head_end = request.find("\r\n\r\n", scanned)) == std::string::npos)
+    {
+        scanned = request.size() < 3 ? 0 : request.size() - 3;
+        if (request.size() >= config.recv_buffer_size ||
+            !recv_more(fd, request, config.recv_buffer_size))
+        {
+            return t_response_answer::RT_BAD_REQUEST;
+        }
+    }
+    const size_t body_start = head_end + 4;
+    size_t length = 0;
+    bool has_length = false;
+    size_t pos = request.find("\r\n") + 2;
+    while (pos < body_start)
+    {
+        const size_t end = request.find("\r\n", pos);
+        const std::string_view line(request.data() + pos, end - pos);
+        pos = end + 2;
+        if (line.size() >= 15 && strncasecmp(line.data(), "Content-Length:", 15) == 0)
+        {
+            // A second Content-Length, in any spelling, makes the framing ambiguous.
+            const size_t value_start = line.find_first_not_of(" \t", 15);
+            const size_t value_end = line.find_last_not_of(" \t") + 1;
+            if (has_length || value_start == std::string_view::npos)
+            {
+                return t_response_answer::RT_BAD_REQUEST;
+            }
+            const auto [ptr, ec] = std::from_chars(line.data() + value_start,
+                line.data() + value_end, length);
+            if (ec != std::errc() || ptr != line.data() + value_end)
+            {
+                return t_response_answer::RT_BAD_REQUEST;
+            }
+            has_length = true;
+        }
+        else if (line.size() >= 18 && strncasecmp(line.data(), "Transfer-Encoding:", 18) == 0)
+        {
+            // Only Content-Length framed bodies are supported.
+            return t_response_answer::RT_NOT_IMPLEMENTED;
+        }
+    }
+    if (length > config.max_body_size)
+    {
+        return t_response_answer::RT_PAYLOAD_TOO_LARGE;
+    }
+    // Bytes past the body would be a pipelined request, which is not served.
+    request.resize(std::min(request.size(), body_start + length));
+    while (request.size() < body_start + length)
+    {
+        if (!recv_more(fd, request, body_start + length))
+        {
+            return t_response_answer::RT_BAD_REQUEST;
+        }
+    }
+    return t_response_answer::RT_OK;
+}
+
+// Malformed requests get 400 and failing handlers 500, instead of the exception
+// escaping the connection thread and terminating the whole server.
+static std::string parse_request(const std::string& request, const ServerContext& ctx,
+    ShardStats& stats)
+{
+    std::optional<HttpRequest> req;
+    try
+    {
+        req.emplace(request);
+    }
+    catch (const std::exception& e)
+    {
+        stats.errors.fetch_add(1, std::memory_order_relaxed);
+        if (ctx.GetConfig().log_requests)
+        {
+            std::cerr << "Bad request: " << e.what() << std::endl;
+        }
+        return error_response(t_response_answer::RT_BAD_REQUEST);
+    }
+    if (ctx.GetConfig().log_requests)
+    {
+        std::cout << "REQUEST: " << *req << std::endl;
+    }
+    try
+    {
+        return handle_http_request(*req, ctx);
+    }
+    catch (const std::exception& e)
+    {
+        stats.errors.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Failed to handle request: " << e.what() << std::endl;
+        return error_response(t_response_answer::RT_SERVER_ERROR);
+    }
+}
+
+std::vector<int> available_cpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty())
+    {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+
+Shard::Shard(unsigned id, int cpu, std::shared_ptr<const ServerConfig> config,
+    RateLimiter* limiter)
+    : m_id(id), m_cpu(cpu), m_config(std::move(config)), m_limiter(limiter)
+{
+    const auto current = m_config.load();
+    if (current->response_cache_entries > 0)
+    {
+        m_cache = std::make_unique<ResponseCache>(current->response_cache_entries,
+            current->response_cache_bytes);
+    }
+    m_upstreams.Update(*current);
+}
+
+Shard::~Shard()
+{
+    if (m_thread.joinable())
+    {
+        m_thread.detach();
+    }
+    if (m_listen_fd >= 0)
+    {
+        close(m_listen_fd);
+    }
+}
+
+bool Shard::Listen()
+{
+    const auto config = m_config.load();
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0)
+    {
+        std::cerr << "Failed to create server socket\n";
+        return false;
+    }
+
+    int reuse = 1;
+    if (setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0)
+    {
+        std::cerr << "Setsockopt failed\n";
+        return false;
+    }
+#ifdef SO_INCOMING_CPU
+    // Hint the kernel to steer connections that arrive on our CPU to this
+    // listener. Failure only costs locality, so it is not fatal.
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &m_cpu, sizeof(m_cpu));
+#endif
+
+    struct sockaddr_in server_addr = {};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config->port);
+    if (inet_pton(AF_INET, config->listen_address.c_str(), &server_addr.sin_addr) != 1)
+    {
+        std::cerr << "Invalid listen address " << config->listen_address << std::endl;
+        return false;
+    }
+
+    if (bind(m_listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) != 0)
+    {
+        std::cerr << "Failed to bind to port " << config->port << std::endl;
+        return false;
+    }
+
+    if (listen(m_listen_fd, config->listen_backlog) != 0)
+    {
+        std::cerr << "Listen failed\n";
+        return false;
+    }
+    return true;
+}
+
+void Shard::Start()
+{
+    m_thread = std::thread(&Shard::Run, this);
+}
+
+void Shard::Stop()
+{
+    m_stop_deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(m_config.load()->shutdown_timeout_ms);
+    m_stopping.store(true, std::memory_order_relaxed);
+    if (m_listen_fd >= 0)
+    {
+        // Wakes the accept thread up; accept() then fails and Run returns.
+        shutdown(m_listen_fd, SHUT_RDWR);
+    }
+}
+
+bool Shard::Join()
+{
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    std::unique_lock<std::mutex> lock(m_connections_mutex);
+    return m_connections_done.wait_until(lock, m_stop_deadline,
+        [this] { return m_connections == 0; });
+}
+
+void Shard::FinishConnection()
+{
+    std::lock_guard<std::mutex> lock(m_connections_mutex);
+    if (--m_connections == 0)
+    {
+        m_connections_done.notify_all();
+    }
+}
+
+void Shard::Publish(std::shared_ptr<const ServerConfig> config)
+{
+    m_upstreams.Update(*config);
+    m_config.store(std::move(config));
+    // Cached bytes were built under the old gzip policy; start over.
+    if (m_cache)
+    {
+        m_cache->Clear();
+    }
+}
+
+void Shard::Run()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(m_cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        std::cerr << "Shard " << m_id << ": failed to pin to CPU " << m_cpu << std::endl;
+    }
+
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    while (true)
+    {
+        client_addr_len = sizeof(client_addr);
+        int client_fd = accept(m_listen_fd, (struct sockaddr*)&client_addr,
+            &client_addr_len);
+        if (client_fd < 0)
+        {
+            if (m_stopping.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                // Out of descriptors or memory: back off and let connections drain.
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            std::cerr << "Accept failed on shard " << m_id << ": " << strerror(errno)
+                      << std::endl;
+            // Let the main thread know that this shard no longer accepts.
+            kill(getpid(), SIGUSR2);
+            break;
+        }
+        m_stats.accepted.fetch_add(1, std::memory_order_relaxed);
+
+        if (m_config.load()->log_requests)
+        {
+            std::cout << "Client connected " << inet_ntoa(client_addr.sin_addr)
+                      << " (shard " << m_id << ")" << std::endl;
+        }
+        if (!Admit(client_fd, client_addr))
+        {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_connections_mutex);
+            ++m_connections;
+        }
+        // The new thread inherits this thread's CPU affinity.
+        std::thread client_thread([this, client_fd]
+            {
+                HandleClient(client_fd);
+                FinishConnection();
+            });
+        client_thread.detach();
+    }
+}
+
+// Rejects clients that are over their rate limit with 429 before anything is read
+// from the socket, so they never get a connection thread.
+bool Shard::Admit(int client_fd, const sockaddr_in& client_addr)
+{
+    if (m_limiter == nullptr)
+    {
+        return true;
+    }
+    const auto config = m_config.load();
+    const uint32_t retry_after = m_limiter->Acquire(ntohl(client_addr.sin_addr.s_addr),
+        config->rate_limit_rps, config->rate_limit_burst);
+    if (retry_after == 0)
+    {
+        return true;
+    }
+    m_stats.rate_limited.fetch_add(1, std::memory_order_relaxed);
+    HttpResponse response(t_response_answer::RT_TOO_MANY_REQUESTS, t_http_version::HV_1_1);
+    response.SetRetryAfter(retry_after);
+    response.SetContentLength(0);
+    const std::string bytes = response.str();
+    send(client_fd, bytes.data(), bytes.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(client_fd);
+    return false;
+}
+
+void Shard::HandleClient(int client_fd)
+{
+    const ServerContext ctx(m_config.load(), m_cache.get(), &m_upstreams);
+    const ServerConfig& config = ctx.GetConfig();
+    if (config.recv_timeout_ms > 0)
+    {
+        timeval timeout;
+        timeout.tv_sec = config.recv_timeout_ms / 1000;
+        timeout.tv_usec = (config.recv_timeout_ms % 1000) * 1000;
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    std::string request;
+    const t_response_answer status = read_request(client_fd, config, request);
+    if (status != t_response_answer::RT_OK)
+    {
+        m_stats.errors.fetch_add(1, std::memory_order_relaxed);
+        if (request.empty())
+        {
+            if (config.log_requests)
+            {
+                std::cerr << "Failed to read from client\n";
+            }
+        }
+        else
+        {
+            const std::string response = error_response(status);
+            send(client_fd, response.data(), response.size(), MSG_NOSIGNAL);
+        }
+        close(client_fd);
+        return;
+    }
+    m_stats.requests.fetch_add(1, std::memory_order_relaxed);
+    const std::string response = parse_request(request, ctx, m_stats);
+    send(client_fd, response.data(), response.size(), MSG_NOSIGNAL);
+    close(client_fd);
+}
@@ -0,0 +1,89 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include "rate_limiter.hpp"
+#include "response_cache.hpp"
+#include "server_context.hpp"
+#include "upstream_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+// Per-shard counters. Aligned to a cache line so that shards running on
+// neighbouring cores never write to the same line.
+struct alignas(64) ShardStats
+{
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> rate_limited{0};
+};
+
+// A shard owns one listening socket (bound with SO_REUSEPORT), its own pointer to
+// the current config, its own response cache, upstream connections and stats. Its
+// accept thread is pinned to a single CPU and connection threads spawned from it
+// inherit that affinity, so nothing on the request path is shared between shards.
+class Shard
+{
+public:
+    Shard(unsigned id, int cpu, std::shared_ptr<const ServerConfig> config,
+        RateLimiter* limiter);
+    ~Shard();
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    bool Listen();
+    void Start();
+    // Stops accepting. Join() then waits for the accept thread and for the
+    // connection threads, which use the shard's state, for up to
+    // shutdown_timeout_ms after Stop(). Returns false if some are still running;
+    // the shard must not be destroyed then.
+    void Stop();
+    bool Join();
+    // Swaps in a new config. Connections already in flight keep the old one.
+    void Publish(std::shared_ptr<const ServerConfig> config);
+    unsigned GetId() const
+    {
+        return m_id;
+    }
+    int GetCpu() const
+    {
+        return m_cpu;
+    }
+    const ShardStats& GetStats() const
+    {
+        return m_stats;
+    }
+private:
+    void Run();
+    void HandleClient(int client_fd);
+    void FinishConnection();
+    bool Admit(int client_fd, const sockaddr_in& client_addr);
+
+private:
+    unsigned m_id;
+    int m_cpu;
+    int m_listen_fd = -1;
+    std::atomic<bool> m_stopping{false};
+    std::atomic<std::shared_ptr<const ServerConfig>> m_config;
+    ShardStats m_stats;
+    std::unique_ptr<ResponseCache> m_cache;
+    UpstreamPool m_upstreams;
+    RateLimiter* m_limiter;
+    std::thread m_thread;
+    std::mutex m_connections_mutex;
+    std::condition_variable m_connections_done;
+    size_t m_connections = 0;
+    std::chrono::steady_clock::time_point m_stop_deadline;
+};
+
+// CPUs the process is allowed to run on, in ascending order.
+std::vector<int> available_cpus();
+
+#endif // !SHARD_HPP
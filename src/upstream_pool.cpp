@@ -0,0 +1,655 @@
+#include "upstream_pool.hpp"
+#include "http_response.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <netdb.h>
+#include <poll.h>
+#include <strings.h>
+#include <unistd.h>
+
+static constexpr size_t g_ring_replicas = 64;
+static constexpr size_t g_max_response_size = 64 * 1024 * 1024;
+
+// Headers that describe the client connection rather than the request. Expect is
+// dropped as well because the body is always sent right after the headers, and
+// Content-Length is written once from the body actually sent.
+static const char* const g_hop_by_hop[] = {"Connection", "Keep-Alive", "Proxy-Connection",
+    "Transfer-Encoding", "TE", "Upgrade", "Expect", "Content-Length"};
+
+// Connection-scoped response headers. The client connection is closed after
+// every response, which the relayed head announces instead.
+static const char* const g_hop_by_hop_response[] = {"Connection", "Keep-Alive",
+    "Proxy-Connection", "TE", "Trailer", "Upgrade"};
+
+static bool iequals(const std::string& a, const char* b)
+{
+    return strcasecmp(a.c_str(), b) == 0;
+}
+
+// Resolves "host:port" to the first address getaddrinfo returns.
+static bool resolve(const std::string& address, sockaddr_storage& addr, socklen_t& len)
+{
+    const size_t colon = address.rfind(':');
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr)
+    {
+        std::cerr << "Failed to resolve upstream " << address << std::endl;
+        return false;
+    }
+    memcpy(&addr, result->ai_addr, result->ai_addrlen);
+    len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+static t_io_result wait_for(int fd, short events, t_deadline deadline)
+{
+    for (;;)
+    {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0)
+        {
+            return t_io_result::IO_TIMEOUT;
+        }
+        pollfd pfd = {fd, events, 0};
+        const int ret = poll(&pfd, 1, static_cast<int>(left));
+        if (ret > 0)
+        {
+            return t_io_result::IO_OK;
+        }
+        if (ret == 0)
+        {
+            return t_io_result::IO_TIMEOUT;
+        }
+        if (errno != EINTR)
+        {
+            return t_io_result::IO_ERROR;
+        }
+    }
+}
+
+static t_io_result connect_to(const sockaddr_storage& addr, socklen_t len,
+    t_deadline deadline, int& fd)
+{
+    fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return t_io_result::IO_ERROR;
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), len) == 0)
+    {
+        return t_io_result::IO_OK;
+    }
+    if (errno != EINPROGRESS)
+    {
+        close(fd);
+        return t_io_result::IO_ERROR;
+    }
+    const t_io_result ready = wait_for(fd, POLLOUT, deadline);
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (ready != t_io_result::IO_OK ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0)
+    {
+        close(fd);
+        return ready == t_io_result::IO_OK ? t_io_result::IO_ERROR : ready;
+    }
+    return t_io_result::IO_OK;
+}
+
+static t_io_result send_all(int fd, const std::string& data, t_deadline deadline)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            const t_io_result ready = wait_for(fd, POLLOUT, deadline);
+            if (ready != t_io_result::IO_OK)
+            {
+                return ready;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        return t_io_result::IO_ERROR;
+    }
+    return t_io_result::IO_OK;
+}
+
+// Appends whatever is available to `out`. Returns IO_CLOSED on EOF.
+static t_io_result recv_some(int fd, std::string& out, t_deadline deadline)
+{
+    char buffer[16384];
+    for (;;)
+    {
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0)
+        {
+            out.append(buffer, n);
+            return out.size() > g_max_response_size ? t_io_result::IO_ERROR
+                                                     : t_io_result::IO_OK;
+        }
+        if (n == 0)
+        {
+            return t_io_result::IO_CLOSED;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            const t_io_result ready = wait_for(fd, POLLIN, deadline);
+            if (ready != t_io_result::IO_OK)
+            {
+                return ready;
+            }
+            continue;
+        }
+        if (errno != EINTR)
+        {
+            return t_io_result::IO_ERROR;
+        }
+    }
+}
+
+// Returns the offset just past a complete chunked body starting at `pos`, or
+// npos if more data is needed. Throws on a malformed chunk size.
+static size_t chunked_end(const std::string& data, size_t pos)
+{
+    for (;;)
+    {
+        const size_t line_end = data.find("\r\n", pos);
+        if (line_end == std::string::npos)
+        {
+            return std::string::npos;
+        }
+        const size_t size = std::stoul(data.substr(pos, line_end - pos), nullptr, 16);
+        pos = line_end + 2;
+        if (size == 0)
+        {
+            if (data.compare(pos, 2, "\r\n") == 0)
+            {
+                return pos + 2;
+            }
+            const size_t trailers_end = data.find("\r\n\r\n", pos);
+            return trailers_end == std::string::npos ? trailers_end : trailers_end + 4;
+        }
+        if (data.size() < pos + size + 2)
+        {
+            return std::string::npos;
+        }
+        pos += size + 2;
+    }
+}
+
+// Reads one full HTTP response. `head` is set for responses to HEAD requests,
+// which end with the header block whatever their Content-Length says.
+// `reusable` tells whether the connection can carry another request afterwards.
+static t_io_result read_response(int fd, t_deadline deadline, bool head, std::string& out,
+    bool& reusable)
+{
+    reusable = false;
+    size_t head_end;
+    while ((head_end = out.find("\r\n\r\n")) == std::string::npos)
+    {
+        const t_io_result ret = recv_some(fd, out, deadline);
+        if (ret == t_io_result::IO_CLOSED && !out.empty())
+        {
+            return t_io_result::IO_ERROR;
+        }
+        if (ret != t_io_result::IO_OK)
+        {
+            return ret;
+        }
+    }
+    const size_t body_start = head_end + 4;
+
+    const size_t status_end = out.find("\r\n");
+    const std::string status_line = out.substr(0, status_end);
+    const size_t code_pos = status_line.find(' ');
+    const int code = code_pos == std::string::npos ? 0 : atoi(status_line.c_str() + code_pos + 1);
+    bool keep_alive = status_line.compare(0, 8, "HTTP/1.1") == 0;
+    bool chunked = false;
+    size_t content_length = std::numeric_limits<size_t>::max();
+    size_t pos = status_end + 2;
+    while (pos < head_end)
+    {
+        const size_t end = out.find("\r\n", pos);
+        const std::string line = out.substr(pos, end - pos);
+        pos = end + 2;
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        const std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        if (iequals(name, "Content-Length"))
+        {
+            content_length = std::stoul(value);
+        }
+        else if (iequals(name, "Transfer-Encoding"))
+        {
+            chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+        }
+        else if (iequals(name, "Connection"))
+        {
+            keep_alive = strcasestr(value.c_str(), "close") == nullptr &&
+                (keep_alive || strcasestr(value.c_str(), "keep-alive") != nullptr);
+        }
+    }
+
+    if (head || (code >= 100 && code < 200) || code == 204 || code == 304)
+    {
+        out.resize(body_start);
+        // An upstream that answers HEAD without framing headers may not know it
+        // must not send a body; do not risk reading one as the next response.
+        const bool framed = chunked || content_length != std::numeric_limits<size_t>::max();
+        reusable = keep_alive && (!head || framed);
+        return t_io_result::IO_OK;
+    }
+    if (chunked)
+    {
+        size_t end;
+        while ((end = chunked_end(out, body_start)) == std::string::npos)
+        {
+            const t_io_result ret = recv_some(fd, out, deadline);
+            if (ret != t_io_result::IO_OK)
+            {
+                return ret == t_io_result::IO_CLOSED ? t_io_result::IO_ERROR : ret;
+            }
+        }
+        out.resize(end);
+        reusable = keep_alive;
+        return t_io_result::IO_OK;
+    }
+    if (content_length != std::numeric_limits<size_t>::max())
+    {
+        while (out.size() < body_start + content_length)
+        {
+            const t_io_result ret = recv_some(fd, out, deadline);
+            if (ret != t_io_result::IO_OK)
+            {
+                return ret == t_io_result::IO_CLOSED ? t_io_result::IO_ERROR : ret;
+            }
+        }
+        out.resize(body_start + content_length);
+        reusable = keep_alive;
+        return t_io_result::IO_OK;
+    }
+    // No framing: the body runs until the upstream closes the connection.
+    for (;;)
+    {
+        const t_io_result ret = recv_some(fd, out, deadline);
+        if (ret == t_io_result::IO_CLOSED)
+        {
+            return t_io_result::IO_OK;
+        }
+        if (ret != t_io_result::IO_OK)
+        {
+            return ret;
+        }
+    }
+}
+
+static std::string build_request(const std::string& path, const HttpRequest& request)
+{
+    const auto& status = request.GetStatus();
+    const auto& headers = request.GetHeaders();
+    std::string out = status.GetRawMethod() + ' ' + path + " HTTP/1.1\r\n";
+    for (const auto& header : headers)
+    {
+        const bool hop_by_hop = std::any_of(std::begin(g_hop_by_hop), std::end(g_hop_by_hop),
+            [&](const char* name) { return iequals(header.first, name); });
+        if (!hop_by_hop)
+        {
+            out += header.first + ": " + header.second + "\r\n";
+        }
+    }
+    const std::string body = request.GetBody();
+    const bool has_length = std::any_of(headers.begin(), headers.end(),
+        [](const auto& header) { return iequals(header.first, "Content-Length"); });
+    if (has_length || !body.empty())
+    {
+        out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    out += "Connection: keep-alive\r\n\r\n";
+    out += body;
+    return out;
+}
+
+// Replaces the hop-by-hop headers of a complete upstream response, and the
+// headers its Connection header names, with "Connection: close".
+static std::string relay_response(const std::string& response)
+{
+    const size_t head_end = response.find("\r\n\r\n");
+    const size_t status_end = response.find("\r\n");
+    std::vector<std::string> names(std::begin(g_hop_by_hop_response),
+        std::end(g_hop_by_hop_response));
+    std::vector<std::pair<std::string, std::string>> headers;
+    size_t pos = status_end + 2;
+    while (pos < head_end + 2)
+    {
+        const size_t end = response.find("\r\n", pos);
+        const std::string line = response.substr(pos, end - pos);
+        pos = end + 2;
+        const size_t colon = line.find(':');
+        std::string name = line.substr(0, colon);
+        if (colon != std::string::npos && iequals(name, "Connection"))
+        {
+            std::istringstream tokens(line.substr(colon + 1));
+            std::string token;
+            while (std::getline(tokens, token, ','))
+            {
+                const size_t begin = token.find_first_not_of(" \t");
+                if (begin != std::string::npos)
+                {
+                    const size_t end = token.find_last_not_of(" \t") + 1;
+                    names.push_back(token.substr(begin, end - begin));
+                }
+            }
+        }
+        headers.emplace_back(std::move(name), line);
+    }
+    std::string out = response.substr(0, status_end + 2);
+    for (const auto& header : headers)
+    {
+        const bool hop_by_hop = std::any_of(names.begin(), names.end(),
+            [&](const std::string& name) { return iequals(header.first, name.c_str()); });
+        if (!hop_by_hop)
+        {
+            out += header.second + "\r\n";
+        }
+    }
+    out += "Connection: close\r\n";
+    out.append(response, head_end + 2);
+    return out;
+}
+
+UpstreamPool::Upstream::~Upstream()
+{
+    for (int fd : idle)
+    {
+        close(fd);
+    }
+}
+
+void UpstreamPool::Update(const ServerConfig& config)
+{
+    std::map<std::string, t_upstream_ptr> current;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& upstream : m_upstreams)
+        {
+            current.emplace(upstream->address, upstream);
+        }
+    }
+    // Only new upstreams are resolved, here and without holding the lock; the
+    // address of a published upstream is never written again.
+    std::vector<t_upstream_ptr> upstreams;
+    for (const auto& address : config.proxy_upstreams)
+    {
+        auto it = current.find(address);
+        if (it != current.end())
+        {
+            upstreams.push_back(it->second);
+            continue;
+        }
+        auto upstream = std::make_shared<Upstream>();
+        upstream->address = address;
+        if (!resolve(address, upstream->addr, upstream->addr_len))
+        {
+            upstream->down_until = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(config.proxy_retry_ms);
+        }
+        upstreams.push_back(std::move(upstream));
+    }
+    std::map<size_t, size_t> ring;
+    for (size_t index = 0; index < upstreams.size(); ++index)
+    {
+        for (size_t i = 0; i < g_ring_replicas; ++i)
+        {
+            ring.emplace(std::hash<std::string>{}(upstreams[index]->address + '#' +
+                std::to_string(i)), index);
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Dropped upstreams close their idle connections once the last request
+    // using them is done.
+    m_upstreams.swap(upstreams);
+    m_ring.swap(ring);
+}
+
+// Looks up again the upstreams whose names did not resolve, at most once per
+// proxy_retry_ms each.
+void UpstreamPool::ResolvePending(const ServerConfig& config)
+{
+    std::vector<t_upstream_ptr> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        for (const auto& upstream : m_upstreams)
+        {
+            if (upstream->addr_len == 0 && upstream->down_until <= now)
+            {
+                upstream->down_until = now +
+                    std::chrono::milliseconds(config.proxy_retry_ms);
+                pending.push_back(upstream);
+            }
+        }
+    }
+    for (const auto& upstream : pending)
+    {
+        sockaddr_storage addr = {};
+        socklen_t len = 0;
+        if (resolve(upstream->address, addr, len))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            upstream->addr = addr;
+            upstream->addr_len = len;
+            upstream->down_until = {};
+        }
+    }
+}
+
+bool UpstreamPool::IsAvailable(const Upstream* upstream,
+    const std::vector<Upstream*>& tried) const
+{
+    return upstream->addr_len != 0 &&
+        upstream->down_until <= std::chrono::steady_clock::now() &&
+        std::find(tried.begin(), tried.end(), upstream) == tried.end();
+}
+
+UpstreamPool::t_upstream_ptr UpstreamPool::Pick(const ServerConfig& config,
+    const std::string& key, const std::vector<Upstream*>& tried)
+{
+    if (m_upstreams.empty())
+    {
+        return nullptr;
+    }
+    t_upstream_ptr picked;
+    if (config.proxy_balance == t_proxy_balance::PB_CONSISTENT_HASH)
+    {
+        // Walk the ring clockwise from the key to the first usable upstream.
+        auto it = m_ring.lower_bound(std::hash<std::string>{}(key));
+        for (size_t i = 0; i < m_ring.size() && picked == nullptr; ++i, ++it)
+        {
+            if (it == m_ring.end())
+            {
+                it = m_ring.begin();
+            }
+            const t_upstream_ptr& upstream = m_upstreams[it->second];
+            if (IsAvailable(upstream.get(), tried))
+            {
+                picked = upstream;
+            }
+        }
+    }
+    else
+    {
+        // Least connections; start from a rotating index so ties are spread out.
+        const size_t start = m_next++;
+        for (size_t i = 0; i < m_upstreams.size(); ++i)
+        {
+            const t_upstream_ptr& upstream =
+                m_upstreams[(start + i) % m_upstreams.size()];
+            if (IsAvailable(upstream.get(), tried) &&
+                (picked == nullptr || upstream->active < picked->active))
+            {
+                picked = upstream;
+            }
+        }
+    }
+    if (picked != nullptr)
+    {
+        ++picked->active;
+    }
+    return picked;
+}
+
+t_io_result UpstreamPool::Acquire(Upstream& upstream, t_deadline deadline, int& fd,
+    bool& reused)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!upstream.idle.empty())
+        {
+            fd = upstream.idle.back();
+            upstream.idle.pop_back();
+            reused = true;
+            return t_io_result::IO_OK;
+        }
+    }
+    reused = false;
+    return connect_to(upstream.addr, upstream.addr_len, deadline, fd);
+}
+
+void UpstreamPool::Release(Upstream& upstream, int fd, bool reusable, size_t max_idle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --upstream.active;
+    if (fd < 0)
+    {
+        return;
+    }
+    if (reusable && upstream.idle.size() < max_idle)
+    {
+        upstream.idle.push_back(fd);
+        return;
+    }
+    close(fd);
+}
+
+t_io_result UpstreamPool::Exchange(Upstream& upstream, const ServerConfig& config,
+    const std::string& wire, bool head, std::string& response, bool& connected)
+{
+    // A pooled connection may have been closed by the upstream while idle. If it
+    // fails before any response byte, retry once on a fresh connection.
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        bool reused = false;
+        const auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(config.proxy_timeout_ms);
+        int fd = -1;
+        t_io_result ret = Acquire(upstream, deadline, fd, reused);
+        connected = ret == t_io_result::IO_OK;
+        if (!connected)
+        {
+            Release(upstream, -1, false, 0);
+            return ret;
+        }
+        response.clear();
+        bool reusable = false;
+        ret = send_all(fd, wire, deadline);
+        if (ret == t_io_result::IO_OK)
+        {
+            try
+            {
+                ret = read_response(fd, deadline, head, response, reusable);
+            }
+            catch (const std::exception&)
+            {
+                ret = t_io_result::IO_ERROR;
+            }
+        }
+        if (ret == t_io_result::IO_OK)
+        {
+            Release(upstream, fd, reusable, config.proxy_max_idle);
+            return ret;
+        }
+        close(fd);
+        const bool stale = reused && response.empty() && ret != t_io_result::IO_TIMEOUT;
+        if (!stale)
+        {
+            Release(upstream, -1, false, 0);
+            return ret;
+        }
+    }
+    Release(upstream, -1, false, 0);
+    return t_io_result::IO_ERROR;
+}
+
+std::string UpstreamPool::Forward(const ServerConfig& config, const std::string& path,
+    const HttpRequest& request)
+{
+    const std::string wire = build_request(path, request);
+    const bool head = request.GetStatus().GetRawMethod() == "HEAD";
+    ResolvePending(config);
+    std::vector<Upstream*> tried;
+    t_io_result ret = t_io_result::IO_ERROR;
+    for (;;)
+    {
+        t_upstream_ptr upstream;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            upstream = Pick(config, path, tried);
+        }
+        if (upstream == nullptr)
+        {
+            break;
+        }
+        std::string response;
+        bool connected = false;
+        ret = Exchange(*upstream, config, wire, head, response, connected);
+        if (ret == t_io_result::IO_OK)
+        {
+            return relay_response(response);
+        }
+        if (connected)
+        {
+            // The request may have reached the upstream; do not replay it elsewhere.
+            break;
+        }
+        // Could not connect: take the upstream out of rotation for a while and
+        // try the next one.
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            upstream->down_until = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(config.proxy_retry_ms);
+        }
+        tried.push_back(upstream.get());
+    }
+    return HttpResponse(ret == t_io_result::IO_TIMEOUT ? t_response_answer::RT_GATEWAY_TIMEOUT
+                                                       : t_response_answer::RT_BAD_GATEWAY,
+        t_http_version::HV_1_1).str();
+}
@@ -0,0 +1,83 @@
+#ifndef UPSTREAM_POOL_HPP
+#define UPSTREAM_POOL_HPP
+
+#include "config.hpp"
+#include "http_request.hpp"
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+enum class t_io_result
+{
+    IO_OK = 0,
+    IO_CLOSED, // peer closed before sending anything
+    IO_TIMEOUT,
+    IO_ERROR
+};
+
+using t_deadline = std::chrono::steady_clock::time_point;
+
+// Keep-alive connections to the proxy upstreams of one shard. Sockets are
+// non-blocking and every connect/send/recv is bounded by proxy_timeout_ms.
+// After a complete response, a connection goes back to the idle list of its
+// upstream, so later requests skip the TCP handshake. An upstream that refuses
+// connections is skipped for proxy_retry_ms and the request goes to the next one.
+//
+// Upstream names are resolved by Update, outside the pool lock. A name that does
+// not resolve is treated as down and looked up again every proxy_retry_ms.
+class UpstreamPool
+{
+public:
+    UpstreamPool() = default;
+    UpstreamPool(const UpstreamPool&) = delete;
+    UpstreamPool& operator=(const UpstreamPool&) = delete;
+
+    // Switches to config.proxy_upstreams. Upstreams that are still listed keep
+    // their idle connections; the idle connections of dropped ones are closed.
+    void Update(const ServerConfig& config);
+
+    // Sends the request to one of the upstreams with `path` as the target and
+    // returns the upstream response with its hop-by-hop headers replaced by
+    // "Connection: close". Returns 502 or 504 when no upstream can answer.
+    std::string Forward(const ServerConfig& config, const std::string& path,
+        const HttpRequest& request);
+private:
+    struct Upstream
+    {
+        Upstream() = default;
+        Upstream(const Upstream&) = delete;
+        Upstream& operator=(const Upstream&) = delete;
+        ~Upstream();
+
+        std::string address;
+        sockaddr_storage addr = {};
+        socklen_t addr_len = 0; // 0 - not resolved
+        size_t active = 0;
+        std::vector<int> idle;
+        std::chrono::steady_clock::time_point down_until;
+    };
+    // Shared so that a request in flight keeps an upstream alive across Update.
+    using t_upstream_ptr = std::shared_ptr<Upstream>;
+
+    t_upstream_ptr Pick(const ServerConfig& config, const std::string& key,
+        const std::vector<Upstream*>& tried);
+    bool IsAvailable(const Upstream* upstream, const std::vector<Upstream*>& tried) const;
+    void ResolvePending(const ServerConfig& config);
+    t_io_result Exchange(Upstream& upstream, const ServerConfig& config,
+        const std::string& wire, bool head, std::string& response, bool& connected);
+    t_io_result Acquire(Upstream& upstream, t_deadline deadline, int& fd, bool& reused);
+    void Release(Upstream& upstream, int fd, bool reusable, size_t max_idle);
+
+private:
+    std::mutex m_mutex;
+    std::vector<t_upstream_ptr> m_upstreams; // in config order
+    std::map<size_t, size_t> m_ring;         // hash -> index into m_upstreams
+    size_t m_next = 0;
+};
+
+#endif // !UPSTREAM_POOL_HPP
@@ -0,0 +1,161 @@
+#include "rate_limiter.hpp"
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Refill so slow that no token comes back while a test runs.
+static constexpr double g_no_refill = 0.001;
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                                      \
+    do                                                                                   \
+    {                                                                                    \
+        if (!(cond))                                                                     \
+        {                                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl;        \
+            ++g_failures;                                                                \
+        }                                                                                \
+    } while (0)
+
+static void test_burst_then_reject()
+{
+    RateLimiter limiter(1024);
+    for (int i = 0; i < 5; ++i)
+    {
+        CHECK(limiter.Acquire(0x0A000001, g_no_refill, 5) == 0);
+    }
+    CHECK(limiter.Acquire(0x0A000001, g_no_refill, 5) >= 1);
+    // Another client is not affected, including 0.0.0.0.
+    CHECK(limiter.Acquire(0x0A000002, g_no_refill, 5) == 0);
+    CHECK(limiter.Acquire(0, g_no_refill, 5) == 0);
+}
+
+static void test_refill()
+{
+    RateLimiter limiter(1024);
+    CHECK(limiter.Acquire(1, 100, 1) == 0);
+    CHECK(limiter.Acquire(1, 100, 1) != 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(limiter.Acquire(1, 100, 1) == 0);
+}
+
+// The smallest table is a single probe window. Once it is full, a new key takes
+// over the least recently used bucket and must start with a full bucket of its
+// own rather than the evicted client's empty one.
+static void test_eviction_resets_bucket()
+{
+    RateLimiter limiter(1);
+    const double burst = 3;
+    for (uint32_t ip = 1; ip <= 8; ++ip)
+    {
+        while (limiter.Acquire(ip, g_no_refill, burst) == 0)
+        {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        CHECK(limiter.Acquire(100, g_no_refill, burst) == 0);
+    }
+    CHECK(limiter.Acquire(100, g_no_refill, burst) != 0);
+    // ip 1 was evicted and comes back with a fresh bucket.
+    CHECK(limiter.Acquire(1, g_no_refill, burst) == 0);
+}
+
+// Many threads hammer a few keys concurrently. Without eviction, every key must
+// grant exactly `burst` requests: more would mean a bucket went negative or was
+// shared between keys, fewer would mean tokens leaked into another bucket.
+static void test_concurrent_exact_budget()
+{
+    constexpr uint32_t keys = 16;
+    constexpr int burst = 500;
+    constexpr int threads = 8;
+    constexpr int attempts = 400;
+    RateLimiter limiter(4096);
+    std::vector<std::atomic<int>> granted(keys);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]()
+        {
+            for (int i = 0; i < attempts; ++i)
+            {
+                for (uint32_t k = 0; k < keys; ++k)
+                {
+                    const uint32_t key = (k + t) % keys;
+                    if (limiter.Acquire(0xC0A80000 + key, g_no_refill, burst) == 0)
+                    {
+                        granted[key].fetch_add(1);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    for (uint32_t k = 0; k < keys; ++k)
+    {
+        CHECK(granted[k].load() == burst);
+    }
+}
+
+// Far more keys than slots, so slots change owner constantly under contention.
+// Every call must terminate with a definite answer, and the table must still
+// hand a new key exactly its burst afterwards.
+static void test_concurrent_eviction()
+{
+    constexpr uint32_t keys = 64;
+    constexpr int threads = 8;
+    constexpr int rounds = 20000;
+    RateLimiter limiter(8);
+    std::atomic<uint64_t> granted{0};
+    std::atomic<uint64_t> rejected{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]()
+        {
+            uint32_t seed = 12345 + t;
+            for (int i = 0; i < rounds; ++i)
+            {
+                seed = seed * 1103515245 + 12345;
+                const uint32_t key = (seed >> 8) % keys;
+                const uint32_t retry = limiter.Acquire(key, g_no_refill, 2);
+                (retry == 0 ? granted : rejected).fetch_add(1);
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    CHECK(granted + rejected == uint64_t(threads) * rounds);
+    CHECK(granted > 0);
+    CHECK(rejected > 0);
+
+    // After the storm, the table still behaves: a new key gets exactly its burst.
+    CHECK(limiter.Acquire(1000, g_no_refill, 2) == 0);
+    CHECK(limiter.Acquire(1000, g_no_refill, 2) == 0);
+    CHECK(limiter.Acquire(1000, g_no_refill, 2) != 0);
+}
+
+int main()
+{
+    test_burst_then_reject();
+    test_refill();
+    test_eviction_resets_bucket();
+    test_concurrent_exact_budget();
+    test_concurrent_eviction();
+    if (g_failures != 0)
+    {
+        std::cerr << g_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All rate limiter tests passed" << std::endl;
+    return 0;
+}